@@ -0,0 +1,71 @@
+#ifndef _OEPARTICLE_EFFECT_RANDOM_GENERATOR_H_
+#define _OEPARTICLE_EFFECT_RANDOM_GENERATOR_H_
+
+#include <ctime>
+
+namespace OpenEngine {
+    namespace Effects {
+
+/**
+ * Small random generator owned by a single effect.
+ *
+ * All state lives in the instance, so effects can be updated on
+ * different threads without sharing a generator. SeedWithTime() mixes
+ * in a per instance counter so effects created in the same second do
+ * not produce the same sequence.
+ */
+class EffectRandomGenerator {
+private:
+    unsigned int state;
+
+    static unsigned int Mix(unsigned int x) {
+        // murmur3 finalizer
+        x ^= x >> 16;
+        x *= 0x85ebca6bu;
+        x ^= x >> 13;
+        x *= 0xc2b2ae35u;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static unsigned int& Instances() {
+        static unsigned int instances = 0;
+        return instances;
+    }
+
+public:
+    EffectRandomGenerator(): state(0x9e3779b9u) {}
+
+    void Seed(unsigned int seed) {
+        state = Mix(seed + 0x9e3779b9u);
+        if (state == 0) state = 0x9e3779b9u;
+    }
+
+    /**
+     * Call from the thread constructing the effects.
+     */
+    void SeedWithTime() {
+        Seed(Mix((unsigned int)time(NULL)) ^ (++Instances() * 0x9e3779b9u));
+    }
+
+    unsigned int Next() {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    float UniformFloat(float min, float max) {
+        float u = (Next() >> 8) * (1.0f / 16777216.0f);
+        return min + u * (max - min);
+    }
+
+    unsigned int UniformInt(unsigned int n) {
+        return n > 0 ? Next() % n : 0;
+    }
+};
+
+}
+}
+#endif
@@ -0,0 +1,114 @@
+#ifndef _OEPARTICLE_EFFECT_RECORDER_H_
+#define _OEPARTICLE_EFFECT_RECORDER_H_
+
+#include <Math/Vector.h>
+#include <Math/Quaternion.h>
+
+#include <ostream>
+#include <string>
+
+namespace OpenEngine {
+    namespace Effects {
+
+using namespace Math;
+
+/**
+ * Binary trace of the input driving a single effect.
+ *
+ * A trace starts with a header holding the random seed of the effect
+ * followed by one record per call into the effect. Each record is a
+ * one byte tag and its payload. Emitter transformations are sampled
+ * on every tick but only written when they change. Values are stored
+ * in host byte order.
+ */
+class EffectTrace {
+public:
+    static const unsigned char VERSION = 1;
+
+    static const char* Magic() {
+        return "OEFX";
+    }
+
+    enum Tag {
+        HANDLE    = 'H', // float dt
+        ACTIVE    = 'A', // uchar active
+        RESET     = 'R', // no payload
+        TRANSFORM = 'T', // float position[3], float rotation[4]
+        EMIT_TEXT = 'E'  // uint length, char text[length], transform
+    };
+};
+
+/**
+ * Writes an EffectTrace. Attach it with SetRecorder() on the effect
+ * before the first tick, that also seeds the effect so the trace can
+ * be replayed with EffectReplayer.
+ */
+class EffectRecorder {
+private:
+    std::ostream& out;
+    unsigned int seed;
+    bool hasTransform;
+    Vector<3,float> position;
+    Quaternion<float> rotation;
+
+    template <class T> void Write(T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void WriteTransform(const Vector<3,float>& pos, Quaternion<float> rot) {
+        Vector<3,float> im = rot.GetImaginary();
+        Write<float>(pos[0]); Write<float>(pos[1]); Write<float>(pos[2]);
+        Write<float>(rot.GetReal());
+        Write<float>(im[0]); Write<float>(im[1]); Write<float>(im[2]);
+    }
+
+public:
+    EffectRecorder(std::ostream& out, unsigned int seed):
+        out(out), seed(seed), hasTransform(false)
+    {
+        out.write(EffectTrace::Magic(), 4);
+        Write<unsigned char>(EffectTrace::VERSION);
+        Write<unsigned int>(seed);
+    }
+
+    unsigned int GetSeed() {
+        return seed;
+    }
+
+    void Handle(float dt) {
+        Write<char>(EffectTrace::HANDLE);
+        Write<float>(dt);
+    }
+
+    void SetActive(bool active) {
+        Write<char>(EffectTrace::ACTIVE);
+        Write<unsigned char>(active ? 1 : 0);
+    }
+
+    void Reset() {
+        Write<char>(EffectTrace::RESET);
+    }
+
+    void Transformation(const Vector<3,float>& pos, Quaternion<float> rot) {
+        if (hasTransform && pos == position &&
+            rot.GetReal() == rotation.GetReal() &&
+            rot.GetImaginary() == rotation.GetImaginary()) return;
+        hasTransform = true;
+        position = pos;
+        rotation = rot;
+        Write<char>(EffectTrace::TRANSFORM);
+        WriteTransform(pos, rot);
+    }
+
+    void EmitText(const std::string& s, const Vector<3,float>& pos,
+                  Quaternion<float> rot) {
+        Write<char>(EffectTrace::EMIT_TEXT);
+        Write<unsigned int>(s.size());
+        out.write(s.data(), s.size());
+        WriteTransform(pos, rot);
+    }
+};
+
+}
+}
+#endif
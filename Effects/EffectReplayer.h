@@ -0,0 +1,153 @@
+#ifndef _OEPARTICLE_EFFECT_REPLAYER_H_
+#define _OEPARTICLE_EFFECT_REPLAYER_H_
+
+#include <Effects/EffectRecorder.h>
+#include <Effects/TextEffect.h>
+
+#include <ParticleSystem/ParticleSystem.h>
+#include <Scene/TransformationNode.h>
+#include <Core/Exceptions.h>
+
+#include <istream>
+#include <string>
+#include <cstring>
+
+namespace OpenEngine {
+    namespace Effects {
+
+using namespace Core;
+using namespace Scene;
+using namespace ParticleSystem;
+
+/**
+ * Drives an effect from an EffectTrace without a running engine.
+ *
+ * The effect must be constructed with the same parameters as the
+ * recorded one. Start() reads the header and seeds the effect, Step()
+ * then replays the trace one tick at a time. The recorded emitter
+ * transformations are applied through a transformation node owned by
+ * the replayer.
+ */
+template <class EFFECT>
+class EffectReplayer {
+private:
+    std::istream& in;
+    OpenEngine::ParticleSystem::ParticleSystem& system;
+    EFFECT* effect;
+    TransformationNode node;
+    unsigned int seed;
+    unsigned int frames;
+
+    template <class T> bool Read(T& value) {
+        in.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return in.gcount() == sizeof(T);
+    }
+
+    bool ReadTransform(TransformationNode& node) {
+        float v[7];
+        for (unsigned int i = 0; i < 7; i++)
+            if (!Read<float>(v[i])) return false;
+        node.SetPosition(Vector<3,float>(v[0], v[1], v[2]));
+        node.SetRotation(Quaternion<float>(v[3], Vector<3,float>(v[4], v[5], v[6])));
+        return true;
+    }
+
+    static void EmitText(TextEffect& effect, string s, TransformationNode* node) {
+        effect.EmitText(s, node);
+    }
+
+    static void EmitText(IParticleEffect& effect, string s, TransformationNode* node) {
+        // only text effects accept text
+    }
+
+public:
+    EffectReplayer(std::istream& in, OpenEngine::ParticleSystem::ParticleSystem& system):
+        in(in), system(system), effect(NULL), seed(0), frames(0) {}
+
+    void Start(EFFECT& effect) {
+        char magic[4];
+        unsigned char version;
+        in.read(magic, 4);
+        if (in.gcount() != 4 || memcmp(magic, EffectTrace::Magic(), 4) != 0)
+            throw Exception("EffectReplayer: not an effect trace");
+        if (!Read<unsigned char>(version) || version != EffectTrace::VERSION)
+            throw Exception("EffectReplayer: unsupported trace version");
+        if (!Read<unsigned int>(seed))
+            throw Exception("EffectReplayer: truncated trace header");
+
+        this->effect = &effect;
+        frames = 0;
+        effect.SetSeed(seed);
+        effect.SetTransformationNode(&node);
+    }
+
+    /**
+     * Replay records up to and including the next tick. Returns false
+     * when the trace is exhausted.
+     */
+    bool Step() {
+        if (!effect) return false;
+        char tag;
+        while (Read<char>(tag)) {
+            switch (tag) {
+            case EffectTrace::HANDLE: {
+                float dt;
+                if (!Read<float>(dt)) return false;
+                effect->Handle(ParticleEventArg(system, dt));
+                frames++;
+                return true;
+            }
+            case EffectTrace::ACTIVE: {
+                unsigned char active;
+                if (!Read<unsigned char>(active)) return false;
+                effect->SetActive(active != 0);
+                break;
+            }
+            case EffectTrace::RESET:
+                effect->Reset();
+                break;
+            case EffectTrace::TRANSFORM:
+                if (!ReadTransform(node)) return false;
+                break;
+            case EffectTrace::EMIT_TEXT: {
+                unsigned int length;
+                if (!Read<unsigned int>(length)) return false;
+                string s(length, '\0');
+                if (length > 0) {
+                    in.read(&s[0], length);
+                    if (in.gcount() != std::streamsize(length)) return false;
+                }
+                TransformationNode pos;
+                if (!ReadTransform(pos)) return false;
+                EmitText(*effect, s, &pos);
+                // EmitText clears the emitter, restore the replay node
+                effect->SetTransformationNode(&node);
+                break;
+            }
+            default:
+                throw Exception("EffectReplayer: corrupt trace");
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Replay the remaining trace. Returns the number of ticks.
+     */
+    unsigned int Run() {
+        while (Step());
+        return frames;
+    }
+
+    unsigned int GetSeed() {
+        return seed;
+    }
+
+    unsigned int GetFrames() {
+        return frames;
+    }
+};
+
+}
+}
+#endif
@@ -0,0 +1,211 @@
+#ifndef _OEPARTICLE_EFFECT_SCHEDULER_H_
+#define _OEPARTICLE_EFFECT_SCHEDULER_H_
+
+#include <ParticleSystem/ParticleSystem.h>
+#include <Effects/ISchedulableEffect.h>
+#include <Effects/TaskPool.h>
+#include <Core/IListener.h>
+
+#include <list>
+#include <map>
+#include <vector>
+
+namespace OpenEngine {
+    namespace Effects {
+
+using namespace Core;
+using namespace ParticleSystem;
+
+/**
+ * Dispatches particle system ticks to a set of effects.
+ *
+ * Attach the scheduler to the particle system instead of the
+ * individual effects. Effects that report IsDormant() after an update
+ * are put to sleep and not visited again until they raise their wake
+ * event. Low priority effects are only updated every N'th tick with
+ * the time accumulated since their last update, and their updates
+ * are spread evenly over the N ticks.
+ *
+ * Effects that are destroyed while scheduled remove themselves
+ * through their destroy event. Do not destroy an effect from within
+ * a tick.
+ *
+ * With a task pool set, the effects due in a tick are updated in
+ * parallel, one task per effect. Prepare() is always called on the
+ * scheduling thread first.
+ */
+class EffectScheduler : public IListener<ParticleEventArg>,
+                        public IListener<EffectWakeEventArg>,
+                        public IListener<EffectDestroyEventArg> {
+public:
+    enum Priority { HIGH, LOW };
+
+private:
+    struct Entry {
+        ISchedulableEffect* effect;
+        Priority priority;
+        unsigned int phase;
+        float dt;
+        bool awake;
+    };
+
+    class UpdateTask : public ITask {
+    public:
+        ISchedulableEffect* effect;
+        ParticleEventArg* arg;
+        float dt;
+
+        void Run() {
+            ParticleEventArg e(*arg);
+            e.dt = dt;
+            effect->Handle(e);
+        }
+    };
+
+    std::map<ISchedulableEffect*, Entry*> entries;
+    std::list<Entry*> awake;
+
+    // per tick scratch space, kept to avoid reallocation
+    std::vector<std::list<Entry*>::iterator> due;
+    std::vector<UpdateTask> tasks;
+    std::vector<ITask*> taskPtrs;
+
+    unsigned int lowRate;
+    unsigned int lowCount;
+    unsigned int frame;
+
+    TaskPool* pool;
+
+public:
+    EffectScheduler(unsigned int lowRate = 4):
+        lowRate(lowRate > 0 ? lowRate : 1),
+        lowCount(0),
+        frame(0),
+        pool(NULL) {}
+
+    virtual ~EffectScheduler() {
+        std::map<ISchedulableEffect*, Entry*>::iterator itr;
+        for (itr = entries.begin(); itr != entries.end(); itr++) {
+            itr->first->WakeEvent().Detach(*this);
+            itr->first->DestroyEvent().Detach(*this);
+            delete itr->second;
+        }
+    }
+
+    void AddEffect(ISchedulableEffect* effect, Priority priority = HIGH) {
+        if (entries.find(effect) != entries.end()) return;
+        Entry* entry = new Entry();
+        entry->effect = effect;
+        entry->priority = priority;
+        entry->phase = (priority == LOW) ? lowCount++ % lowRate : 0;
+        entry->dt = 0.0;
+        entry->awake = true;
+        entries[effect] = entry;
+        awake.push_back(entry);
+        effect->WakeEvent().Attach(*this);
+        effect->DestroyEvent().Attach(*this);
+    }
+
+    void RemoveEffect(ISchedulableEffect* effect) {
+        std::map<ISchedulableEffect*, Entry*>::iterator itr = entries.find(effect);
+        if (itr == entries.end()) return;
+        Entry* entry = itr->second;
+        if (entry->awake) awake.remove(entry);
+        effect->WakeEvent().Detach(*this);
+        effect->DestroyEvent().Detach(*this);
+        entries.erase(itr);
+        delete entry;
+    }
+
+    void Handle(ParticleEventArg e) {
+        frame++;
+        due.clear();
+        tasks.clear();
+        std::list<Entry*>::iterator itr;
+        for (itr = awake.begin(); itr != awake.end(); itr++) {
+            Entry* entry = *itr;
+            float dt = e.dt;
+            if (entry->priority == LOW) {
+                entry->dt += e.dt;
+                if (frame % lowRate != entry->phase) continue;
+                dt = entry->dt;
+                entry->dt = 0.0;
+            }
+            entry->effect->Prepare(dt);
+            due.push_back(itr);
+            UpdateTask task;
+            task.effect = entry->effect;
+            task.arg = &e;
+            task.dt = dt;
+            tasks.push_back(task);
+        }
+
+        if (pool && tasks.size() > 1) {
+            taskPtrs.clear();
+            for (unsigned int i = 0; i < tasks.size(); i++)
+                taskPtrs.push_back(&tasks[i]);
+            pool->Run(taskPtrs);
+        }
+        else {
+            for (unsigned int i = 0; i < tasks.size(); i++)
+                tasks[i].Run();
+        }
+
+        for (unsigned int i = 0; i < due.size(); i++) {
+            Entry* entry = *due[i];
+            if (entry->effect->IsDormant()) {
+                entry->awake = false;
+                entry->dt = 0.0;
+                awake.erase(due[i]);
+            }
+        }
+    }
+
+    void Handle(EffectWakeEventArg e) {
+        std::map<ISchedulableEffect*, Entry*>::iterator itr = entries.find(e.effect);
+        if (itr == entries.end()) return;
+        Entry* entry = itr->second;
+        if (entry->awake) return;
+        entry->awake = true;
+        awake.push_back(entry);
+    }
+
+    void Handle(EffectDestroyEventArg e) {
+        std::map<ISchedulableEffect*, Entry*>::iterator itr = entries.find(e.effect);
+        if (itr == entries.end()) return;
+        Entry* entry = itr->second;
+        if (entry->awake) awake.remove(entry);
+        // the effect's events are being torn down and are notifying
+        // right now, so do not detach from them
+        entries.erase(itr);
+        delete entry;
+    }
+
+    unsigned int GetNumberOfEffects() {
+        return entries.size();
+    }
+
+    unsigned int GetNumberOfAwakeEffects() {
+        return awake.size();
+    }
+
+    unsigned int GetLowPriorityRate() {
+        return lowRate;
+    }
+
+    /**
+     * Update effects in parallel on the given pool, or serially when
+     * NULL. The pool is not owned by the scheduler.
+     */
+    void SetTaskPool(TaskPool* pool) {
+        this->pool = pool;
+    }
+
+    TaskPool* GetTaskPool() {
+        return pool;
+    }
+};
+
+}
+}
+#endif
@@ -5,6 +5,11 @@
 #include <ParticleSystem/ParticleSystem.h>
 #include <ParticleSystem/ParticleCollection.h>
 #include <ParticleSystem/IParticleEffect.h>
+#include <Effects/ISchedulableEffect.h>
+#include <Effects/ParticleCuller.h>
+#include <Effects/EffectRecorder.h>
+#include <Effects/ParticlePool.h>
+#include <Effects/ParticleIdentity.h>
 
 // particle types
 #include <ParticleSystem/Particles/IParticle.h>
@@ -23,9 +28,7 @@
 #include <ParticleSystem/EulerModifier.h>
 #include <ParticleSystem/TextureRotationModifier.h>
 #include <ParticleSystem/LinearValueModifier.h>
-
-// predefined initializers
-#include <ParticleSystem/RandomTextureInitializer.h>
+#include <Effects/TurbulenceModifier.h>
 
 #include <Renderers/IRenderer.h>
 #include <Renderers/IRenderingView.h>
@@ -38,10 +41,12 @@
 
 #include <Meta/OpenGL.h>
 
-#include <Math/RandomGenerator.h>
+#include <Effects/EffectRandomGenerator.h>
 
 #include <Scene/TransformationNode.h>
 
+#include <vector>
+
 namespace OpenEngine {
     namespace Effects {
 
@@ -51,15 +56,16 @@ using namespace ParticleSystem;
 using namespace Resources;
 using namespace Math;
 
-class FireEffect : public IParticleEffect {
+class FireEffect : public ISchedulableEffect {
 public:
-    typedef Color < Texture <Size < Velocity < Forces < Position < Life < IParticle > > > > > > >  TYPE;
+    typedef Identity < Color < Texture <Size < Velocity < Forces < Position < Life < IParticle > > > > > > > >  TYPE;
 
 private:
     class ParticleRenderer: public RenderNode {
     public:
-        ParticleRenderer(ParticleCollection<TYPE>* particles, Renderers::TextureLoader& textureLoader):
-            particles(particles), textureLoader(textureLoader) {}
+        ParticleRenderer(ParticlePool<TYPE>* particles, Renderers::TextureLoader& textureLoader,
+                         ParticleCuller& culler):
+            particles(particles), textureLoader(textureLoader), culler(culler) {}
         virtual ~ParticleRenderer() {}
         
         void Apply(RenderingEventArg arg, ISceneNodeVisitor& v) {
@@ -75,58 +81,83 @@ private:
             glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
             glEnable(GL_TEXTURE_2D);
             glEnable(GL_COLOR_MATERIAL);
+
+            // cull against the current camera before touching gl state
+            // for each quad
+            float mv[16], proj[16];
+            GLint viewport[4];
+            glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+            glGetFloatv(GL_PROJECTION_MATRIX, proj);
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            culler.SetCamera(mv, proj, viewport[2], viewport[3]);
+            culler.Begin();
+            for (unsigned int i = 0; i < particles->GetChunkCount(); i++) {
+                ParticleCollection<TYPE>* chunk = particles->GetChunk(i);
+                for (chunk->iterator.Reset(); 
+                     chunk->iterator.HasNext(); 
+                     chunk->iterator.Next()) {
+                    TYPE& particle = chunk->iterator.Element();
+                    culler.Test(particle.position, particle.size, particle.color[3],
+                                particle.id);
+                }
+            }
+            culler.End();
     
-            for (particles->iterator.Reset(); 
-                 particles->iterator.HasNext(); 
-                 particles->iterator.Next()) {
+            for (unsigned int i = 0; i < particles->GetChunkCount(); i++) {
+                ParticleCollection<TYPE>* chunk = particles->GetChunk(i);
+                for (chunk->iterator.Reset(); 
+                     chunk->iterator.HasNext(); 
+                     chunk->iterator.Next()) {
                 
-                TYPE& particle = particles->iterator.Element();
-                ITexture2DPtr texr = particle.texture;
+                    TYPE& particle = chunk->iterator.Element();
+                    if (!culler.Next()) continue;
+                    ITexture2DPtr texr = particle.texture;
                 
-                //Set texture
-                if (texr != NULL) {
-                    if (texr->GetID() == 0) {
-                        textureLoader.Load(texr);
-                        //logger.info << texr->GetID() << logger.end;
+                    //Set texture
+                    if (texr != NULL) {
+                        if (texr->GetID() == 0) {
+                            textureLoader.Load(texr);
+                            //logger.info << texr->GetID() << logger.end;
+                        }
+                        glBindTexture(GL_TEXTURE_2D, texr->GetID());
                     }
-                    glBindTexture(GL_TEXTURE_2D, texr->GetID());
-                }
                 
-                else {
-                    glBindTexture(GL_TEXTURE_2D, 0);
-                }
+                    else {
+                        glBindTexture(GL_TEXTURE_2D, 0);
+                    }
                 
-                glPushMatrix();
-                glTranslatef(particle.position[0], particle.position[1], particle.position[2]);
+                    glPushMatrix();
+                    glTranslatef(particle.position[0], particle.position[1], particle.position[2]);
                 
-                // billboard
-                float modelview[16];
-                glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
-                modelview[0] = modelview[5] = modelview[10] = 1.0;
-                modelview[1] = modelview[2] = modelview[4] = 
-                    modelview[6] = modelview[8] = modelview[9] = 0.0; 
-                glLoadMatrixf(modelview);
+                    // billboard
+                    float modelview[16];
+                    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+                    modelview[0] = modelview[5] = modelview[10] = 1.0;
+                    modelview[1] = modelview[2] = modelview[4] = 
+                        modelview[6] = modelview[8] = modelview[9] = 0.0; 
+                    glLoadMatrixf(modelview);
                 
-                // apply quad transformations
-                glRotatef(particle.rotation, 0,0,1);
-                float scale = particle.size;
-                glScalef(scale,scale,scale);
-                float c[4];
-                particle.color.ToArray(c);
-                glColor4fv(c);
+                    // apply quad transformations
+                    glRotatef(particle.rotation, 0,0,1);
+                    float scale = particle.size;
+                    glScalef(scale,scale,scale);
+                    float c[4];
+                    particle.color.ToArray(c);
+                    glColor4fv(c);
                 
-                glBegin(GL_QUADS);
-                glTexCoord2f(0.0, 0.0);
-                glVertex3f(-1.0, -1.0, 0.0);
-                glTexCoord2f(0.0, 1.0);
-                glVertex3f(-1.0, 1.0, 0);
-                glTexCoord2f(1.0, 1.0);
-                glVertex3f(1, 1, 0);
-                glTexCoord2f(1.0, 0.0);
-                glVertex3f(1, -1, 0);
-                glEnd();
+                    glBegin(GL_QUADS);
+                    glTexCoord2f(0.0, 0.0);
+                    glVertex3f(-1.0, -1.0, 0.0);
+                    glTexCoord2f(0.0, 1.0);
+                    glVertex3f(-1.0, 1.0, 0);
+                    glTexCoord2f(1.0, 1.0);
+                    glVertex3f(1, 1, 0);
+                    glTexCoord2f(1.0, 0.0);
+                    glVertex3f(1, -1, 0);
+                    glEnd();
                 
-                glPopMatrix();
+                    glPopMatrix();
+                }
             }
             glPopAttrib();
             glDisable(GL_BLEND);
@@ -137,14 +168,15 @@ private:
         }
 
     private:
-        ParticleCollection<TYPE>* particles;
+        ParticlePool<TYPE>* particles;
         TextureLoader& textureLoader; 
+        ParticleCuller& culler;
     };
     
     unsigned int totalEmits;
 
 protected:
-    ParticleCollection<TYPE>* particles;
+    ParticlePool<TYPE>* particles;
 
     // emit attributes
     float number;
@@ -170,10 +202,11 @@ protected:
 
     bool active;
     
+    ParticleCuller culler;
     ParticleRenderer* pr;
 
-    //initializers
-    RandomTextureInitializer<TYPE> inittex;
+    // textures picked at random for new particles
+    std::vector<ITexture2DPtr> textures;
 
     //modifiers
     EulerModifier<TYPE> euler;
@@ -182,9 +215,19 @@ protected:
     LinearValueModifier<TYPE,float> sizem;
     LifespanModifier<TYPE> lifemod;
     TextureRotationModifier<TYPE> rotationmod;
+    TurbulenceModifier<TYPE> wind;
 
-    RandomGenerator randomgen;
+    EffectRandomGenerator randomgen;
     TransformationNode* transPos;
+    EffectRecorder* recorder;
+
+    // id of the next emitted particle
+    unsigned int nextId;
+
+    // emitter transformation read in Prepare()
+    Vector<3,float> emitPosition;
+    Quaternion<float> emitDirection;
+    bool prepared;
 
 public:
     FireEffect(OpenEngine::ParticleSystem::ParticleSystem& system,
@@ -198,7 +241,7 @@ public:
                Vector<3,float> antigravity,
                Renderers::TextureLoader& textureLoader): 
         totalEmits(0),
-        particles(system.CreateParticles<TYPE>(numParticles)),
+        particles(new ParticlePool<TYPE>(system, numParticles)),
         number(number), numberVar(numberVar),
         life(life), lifeVar(lifeVar),
         angle(angle),
@@ -208,9 +251,12 @@ public:
         emitRate(emitRate),
         system(system),
         active(true),
-        pr(new ParticleRenderer(particles, textureLoader)),
+        pr(new ParticleRenderer(particles, textureLoader, culler)),
         antigravity(antigravity),
-        transPos(NULL) 
+        transPos(NULL),
+        recorder(NULL),
+        nextId(0),
+        prepared(false)
     {
         randomgen.SeedWithTime();
     }
@@ -218,7 +264,7 @@ public:
     FireEffect(OpenEngine::ParticleSystem::ParticleSystem& system, 
                TextureLoader& textureLoader): 
         totalEmits(0),
-        particles(system.CreateParticles<TYPE>(200)),
+        particles(new ParticlePool<TYPE>(system, 200)),
         number(7.0),
         numberVar(2.0),
         life(2100.0),
@@ -232,9 +278,12 @@ public:
         emitRate(0.04),
         system(system),
         active(true),
-        pr(new ParticleRenderer(particles, textureLoader)),
+        pr(new ParticleRenderer(particles, textureLoader, culler)),
         antigravity(Vector<3,float>(0,0.182,0)),
-        transPos(NULL)
+        transPos(NULL),
+        recorder(NULL),
+        nextId(0),
+        prepared(false)
     {        
         randomgen.SeedWithTime();
     }
@@ -243,7 +292,30 @@ public:
     delete particles;
 }
 
+void Prepare(float dt) {
+    emitPosition = Vector<3,float>();
+    emitDirection = Quaternion<float>();
+    if (transPos)
+        transPos->GetAccumulatedTransformations(&emitPosition, &emitDirection);
+
+    // grow now for the most Handle() can emit, it only emits into
+    // the room there is and never resizes the particle storage
+    float most = ceil(number + fabs(numberVar));
+    if (active && emitRate > 0 && most > 0) {
+        unsigned int emits = unsigned((emitdt + dt) / emitRate);
+        particles->Reserve(emits * unsigned(most));
+    }
+    prepared = true;
+}
+
 void Handle(ParticleEventArg e) {
+    if (!prepared) Prepare(e.dt);
+
+    if (recorder) {
+        recorder->Transformation(emitPosition, emitDirection);
+        recorder->Handle(e.dt);
+    }
+
     if (active) {
         // fixed emit rate
         emitdt += e.dt;
@@ -253,27 +325,33 @@ void Handle(ParticleEventArg e) {
         }
     }
 
-    for (particles->iterator.Reset(); 
-         particles->iterator.HasNext(); 
-         particles->iterator.Next()) {
-        TYPE& particle = particles->iterator.Element();
+    wind.Update(e.dt);
+    for (unsigned int i = 0; i < particles->GetChunkCount(); i++) {
+        ParticleCollection<TYPE>* chunk = particles->GetChunk(i);
+        for (chunk->iterator.Reset(); 
+             chunk->iterator.HasNext(); 
+             chunk->iterator.Next()) {
+            TYPE& particle = chunk->iterator.Element();
         
-        // custom modify particles
+            // custom modify particles
         
-        // predefined particle modifiers
+            // predefined particle modifiers
         
-        //wind.Process(e.dt, particle);
-        antigravity.Process(e.dt, particle);
-        //        sizemod.Process(particle);
-        euler.Process(e.dt, particle);
-        sizem.Process(e.dt, particle, particle.size);
-        colormod.Process(e.dt, particle, particle.color);
-        rotationmod.Process(particle);
-        lifemod.Process(e.dt, particle);
+            wind.Process(e.dt, particle);
+            antigravity.Process(e.dt, particle);
+            //        sizemod.Process(particle);
+            euler.Process(e.dt, particle);
+            sizem.Process(e.dt, particle, particle.size);
+            colormod.Process(e.dt, particle, particle.color);
+            rotationmod.Process(particle);
+            lifemod.Process(e.dt, particle);
         
-        if (particle.life >= particle.maxlife)
-            particles->iterator.Delete();
+            if (particle.life >= particle.maxlife)
+                chunk->iterator.Delete();
+        }
     }
+    particles->Update(e.dt);
+    prepared = false;
 }
 
 inline float RandomAttribute(float base, float variance) {
@@ -285,16 +363,19 @@ unsigned int GetTotalEmits() {
     return totalEmits;
 }
 
+/**
+ * Emits from the transformation read by the last Prepare(). Within
+ * Handle() the particle storage is not grown.
+ */
 unsigned int inline Emit() {
 //     if (particles->GetActiveParticles() >= particles->GetSize())
 //         return;
-    Vector<3,float> position;
-    Quaternion<float> direction;
-    if (transPos)
-        transPos->GetAccumulatedTransformations(&position, &direction);    
+    Vector<3,float> position = emitPosition;
+    Quaternion<float> direction = emitDirection;
 
-    unsigned int emits = min(unsigned(round(RandomAttribute(number, numberVar))),
-                    particles->GetSize()-particles->GetActiveParticles());
+    // number may be below its variance, never emit a negative count
+    float count = round(RandomAttribute(number, numberVar));
+    unsigned int emits = particles->Reserve(count > 0 ? unsigned(count) : 0, !prepared);
     
     for (unsigned int i = 0; i < emits; i++) {
         TYPE& particle = particles->NewParticle();
@@ -303,12 +384,14 @@ unsigned int inline Emit() {
         particle.position = position;
         
         particle.life = 0;
+        particle.id = nextId++;
         particle.maxlife = RandomAttribute(life, lifeVar);
         particle.rotation = 0;
         particle.spin = RandomAttribute(spin, spinVar);
 
         // texture
-        inittex.Process(particle);
+        if (!textures.empty())
+            particle.texture = textures[randomgen.UniformInt(textures.size())];
     
         // random direction
         float r = randomgen.UniformFloat(-1.0,1.0)*angle;
@@ -337,16 +420,39 @@ ISceneNode* GetSceneNode() {
     return pr;
 }
 
+ParticlePool<TYPE>* GetParticlePool() {
+    return particles;
+}
+
+ParticleCuller& GetCuller() {
+    return culler;
+}
+
+/**
+ * Wind is off until a field is set, e.g.
+ * GetWind().SetField(&TurbulenceField::GetShared()).
+ */
+TurbulenceModifier<TYPE>& GetWind() {
+    return wind;
+}
+
 void SetActive(bool active) {
+    if (recorder) recorder->SetActive(active);
     this->active = active;
     if (!active) emitdt = 0;
+    else Wake();
 }
 
 bool GetActive() {
     return active;
 }
 
+bool IsDormant() {
+    return !active && particles->GetActiveParticles() == 0;
+}
+
 void Reset() {
+    if (recorder) recorder->Reset();
     totalEmits = 0;
     emitdt = 0.0;
 }
@@ -355,7 +461,7 @@ void AddTexture(ITexture2DPtr texr) {
     #ifdef OE_SAFE
     if (!texr.get()) throw new Exception("FireEffect null texture"); 
     #endif
-    inittex.AddTextureResource(texr);
+    textures.push_back(texr);
 }
 
 TransformationNode* GetTransformationNode() {
@@ -366,6 +472,25 @@ void SetTransformationNode(TransformationNode* node) {
     transPos = node;
 }
 
+void SetSeed(unsigned int seed) {
+    randomgen.Seed(seed);
+}
+
+/**
+ * Record all input to this effect. Attach before the first tick, the
+ * effect is reseeded from the recorder.
+ */
+void SetRecorder(EffectRecorder* recorder) {
+    this->recorder = recorder;
+    if (!recorder) return;
+    SetSeed(recorder->GetSeed());
+    recorder->SetActive(active);
+}
+
+EffectRecorder* GetRecorder() {
+    return recorder;
+}
+
 };
 
 }
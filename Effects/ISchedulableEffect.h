@@ -0,0 +1,75 @@
+#ifndef _OEPARTICLE_ISCHEDULABLE_EFFECT_H_
+#define _OEPARTICLE_ISCHEDULABLE_EFFECT_H_
+
+#include <ParticleSystem/IParticleEffect.h>
+#include <Core/IEvent.h>
+#include <Core/Event.h>
+
+namespace OpenEngine {
+    namespace Effects {
+
+using namespace Core;
+using namespace ParticleSystem;
+
+class ISchedulableEffect;
+
+/**
+ * Raised by an effect when it leaves the dormant state, e.g. when it
+ * is activated or asked to emit.
+ */
+struct EffectWakeEventArg {
+    ISchedulableEffect* effect;
+    EffectWakeEventArg(ISchedulableEffect* effect): effect(effect) {}
+};
+
+/**
+ * Raised from the effect destructor. The effect is no longer usable,
+ * only compare the pointer.
+ */
+struct EffectDestroyEventArg {
+    ISchedulableEffect* effect;
+    EffectDestroyEventArg(ISchedulableEffect* effect): effect(effect) {}
+};
+
+/**
+ * Particle effect that can be put to sleep by the EffectScheduler.
+ *
+ * An effect is dormant when updating it would be a no-op: it has no
+ * live particles and will not emit any on its own. Implementations
+ * must call Wake() whenever that stops being true.
+ */
+class ISchedulableEffect : public IParticleEffect {
+protected:
+    Event<EffectWakeEventArg> wakeEvent;
+    Event<EffectDestroyEventArg> destroyEvent;
+
+    void Wake() {
+        wakeEvent.Notify(EffectWakeEventArg(this));
+    }
+
+public:
+    virtual ~ISchedulableEffect() {
+        destroyEvent.Notify(EffectDestroyEventArg(this));
+    }
+
+    virtual bool IsDormant() = 0;
+
+    /**
+     * Called on the scheduling thread before Handle(), which may then
+     * run on a worker thread. Read shared scene state and grow
+     * particle storage here, not in Handle().
+     */
+    virtual void Prepare(float dt) {}
+
+    IEvent<EffectWakeEventArg>& WakeEvent() {
+        return wakeEvent;
+    }
+
+    IEvent<EffectDestroyEventArg>& DestroyEvent() {
+        return destroyEvent;
+    }
+};
+
+}
+}
+#endif
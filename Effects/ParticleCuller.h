@@ -0,0 +1,244 @@
+#ifndef _OEPARTICLE_PARTICLE_CULLER_H_
+#define _OEPARTICLE_PARTICLE_CULLER_H_
+
+#include <Math/Vector.h>
+#include <vector>
+#include <cstring>
+
+namespace OpenEngine {
+    namespace Effects {
+
+using namespace Math;
+
+/**
+ * Screen space culling of billboard particles.
+ *
+ * Particles are first tested in iteration order with Test(), which
+ * rejects particles that are behind the camera, outside the viewport,
+ * smaller than the pixel threshold or nearly transparent, and sums up
+ * the screen area of the remaining ones. End() compares that area to
+ * the overdraw budget, given in multiples of the viewport area, and
+ * the second pass then calls Next() for each particle in the same
+ * order to find out whether to draw it. When the budget is exceeded
+ * surviving particles are thinned by a hash of a per particle key,
+ * which must stay fixed over the particle's life, so the same
+ * particles stay dropped from frame to frame.
+ *
+ * The culler does not touch OpenGL, the camera is given as column
+ * major modelview and projection matrices, so it can be driven
+ * without a rendering context.
+ */
+class ParticleCuller {
+private:
+    float modelview[16];
+    float projection[16];
+    float width, height;
+
+    bool enabled;
+    float minPixelSize;
+    float minAlpha;
+    float overdrawBudget;
+
+    // thinning rank in [0,1) per tested particle, -1 when culled
+    std::vector<float> ranks;
+    unsigned int next;
+    float coverage;
+    float keepRatio;
+
+    unsigned int culled;
+    unsigned int thinned;
+
+    static float Rank(unsigned int x) {
+        // spread sequential ids and the exponent bits of float keys
+        // before the murmur3 finalizer
+        x *= 0x9e3779b9u;
+        x ^= x >> 16;
+        x *= 0x85ebca6bu;
+        x ^= x >> 13;
+        x *= 0xc2b2ae35u;
+        x ^= x >> 16;
+        return (x >> 8) * (1.0f / 16777216.0f);
+    }
+
+public:
+    ParticleCuller():
+        width(1), height(1),
+        enabled(true),
+        minPixelSize(0.5),
+        minAlpha(1.0/255.0),
+        overdrawBudget(0.0),
+        next(0),
+        coverage(0.0),
+        keepRatio(1.0),
+        culled(0),
+        thinned(0)
+    {
+        for (unsigned int i = 0; i < 16; i++)
+            modelview[i] = projection[i] = (i % 5 == 0) ? 1.0 : 0.0;
+    }
+
+    void SetCamera(const float modelview[16], const float projection[16],
+                   int width, int height) {
+        for (unsigned int i = 0; i < 16; i++) {
+            this->modelview[i] = modelview[i];
+            this->projection[i] = projection[i];
+        }
+        this->width = width > 0 ? width : 1;
+        this->height = height > 0 ? height : 1;
+    }
+
+    void Begin() {
+        ranks.clear();
+        next = 0;
+        coverage = 0.0;
+        keepRatio = 1.0;
+        culled = 0;
+        thinned = 0;
+    }
+
+    /**
+     * Test a particle with the given world position, billboard half
+     * size and alpha. The key selects the particle for thinning and
+     * must be unique and fixed for its life, e.g. the Identity id set
+     * at emission. Returns whether it survived culling.
+     */
+    bool Test(const Vector<3,float>& position, float size, float alpha,
+              unsigned int key) {
+        if (!enabled) {
+            ranks.push_back(0.0);
+            return true;
+        }
+        const float* m = modelview;
+        const float* p = projection;
+        float x = position[0], y = position[1], z = position[2];
+
+        float ex = m[0]*x + m[4]*y + m[8]*z  + m[12];
+        float ey = m[1]*x + m[5]*y + m[9]*z  + m[13];
+        float ez = m[2]*x + m[6]*y + m[10]*z + m[14];
+        float ew = m[3]*x + m[7]*y + m[11]*z + m[15];
+
+        float cx = p[0]*ex + p[4]*ey + p[8]*ez  + p[12]*ew;
+        float cy = p[1]*ex + p[5]*ey + p[9]*ez  + p[13]*ew;
+        float cw = p[3]*ex + p[7]*ey + p[11]*ez + p[15]*ew;
+
+        bool keep = true;
+        if (alpha < minAlpha || cw <= 0.0)
+            keep = false;
+        else {
+            // the renderer resets the modelview rotation, so the
+            // quad keeps its size in eye space
+            float rx = size * p[0] / cw;
+            float ry = size * p[5] / cw;
+            float nx = cx / cw, ny = cy / cw;
+            // the quad is spun around its centre, so its corners can
+            // reach sqrt(2) times the half size
+            float bx = rx * 1.4142f, by = ry * 1.4142f;
+            if (nx + bx < -1.0 || nx - bx > 1.0 ||
+                ny + by < -1.0 || ny - by > 1.0)
+                keep = false;
+            else {
+                float pw = rx * width;
+                float ph = ry * height;
+                if (pw < minPixelSize && ph < minPixelSize)
+                    keep = false;
+                else {
+                    float area = pw * ph;
+                    float screen = width * height;
+                    coverage += (area < screen ? area : screen) / screen;
+                }
+            }
+        }
+        if (!keep) culled++;
+        ranks.push_back(keep ? Rank(key) : -1.0f);
+        return keep;
+    }
+
+    /**
+     * Fallback for particles without an id, keyed by a float that is
+     * fixed for the particle's life such as its max life. Particles
+     * sharing the value are thinned together.
+     */
+    bool Test(const Vector<3,float>& position, float size, float alpha,
+              float key) {
+        unsigned int bits;
+        memcpy(&bits, &key, sizeof(bits));
+        return Test(position, size, alpha, bits);
+    }
+
+    void End() {
+        if (enabled && overdrawBudget > 0.0 && coverage > overdrawBudget)
+            keepRatio = overdrawBudget / coverage;
+    }
+
+    /**
+     * Returns whether the next particle, in the order it was tested,
+     * should be drawn.
+     */
+    bool Next() {
+        if (next >= ranks.size()) return true;
+        float rank = ranks[next++];
+        if (rank < 0.0) return false;
+        if (rank < keepRatio) return true;
+        thinned++;
+        return false;
+    }
+
+    void SetEnabled(bool enabled) {
+        this->enabled = enabled;
+    }
+
+    bool GetEnabled() {
+        return enabled;
+    }
+
+    void SetMinPixelSize(float size) {
+        minPixelSize = size;
+    }
+
+    float GetMinPixelSize() {
+        return minPixelSize;
+    }
+
+    void SetMinAlpha(float alpha) {
+        minAlpha = alpha;
+    }
+
+    float GetMinAlpha() {
+        return minAlpha;
+    }
+
+    /**
+     * Maximum screen coverage in multiples of the viewport area. Zero
+     * disables thinning.
+     */
+    void SetOverdrawBudget(float budget) {
+        overdrawBudget = budget;
+    }
+
+    float GetOverdrawBudget() {
+        return overdrawBudget;
+    }
+
+    float GetCoverage() {
+        return coverage;
+    }
+
+    /**
+     * Fraction of the surviving particles drawn after End().
+     */
+    float GetKeepRatio() {
+        return keepRatio;
+    }
+
+    unsigned int GetCulled() {
+        return culled;
+    }
+
+    unsigned int GetThinned() {
+        return thinned;
+    }
+};
+
+}
+}
+#endif
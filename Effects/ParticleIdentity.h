@@ -0,0 +1,19 @@
+#ifndef _OEPARTICLE_PARTICLE_IDENTITY_H_
+#define _OEPARTICLE_PARTICLE_IDENTITY_H_
+
+namespace OpenEngine {
+    namespace Effects {
+
+/**
+ * Particle attribute holding an id that is set once at emission and
+ * stays with the particle for its life.
+ */
+template <class T>
+class Identity : public T {
+public:
+    unsigned int id;
+};
+
+}
+}
+#endif
@@ -0,0 +1,182 @@
+#ifndef _OEPARTICLE_PARTICLE_POOL_H_
+#define _OEPARTICLE_PARTICLE_POOL_H_
+
+#include <ParticleSystem/ParticleSystem.h>
+#include <ParticleSystem/ParticleCollection.h>
+
+#include <vector>
+
+namespace OpenEngine {
+    namespace Effects {
+
+using namespace ParticleSystem;
+
+/**
+ * Particle storage that grows and shrinks with the load.
+ *
+ * The pool is a list of fixed size particle collections. When an
+ * effect reserves more particles than are free, new chunks are
+ * created, up to the maximum capacity. Existing chunks are never
+ * reallocated so live particles stay where they are, but chunks must
+ * only be added outside the particle iteration, i.e. by calling
+ * Reserve() before the update loop.
+ *
+ * NewParticle() tracks the high-water mark, so the peak right after
+ * emission is seen. Update() removes empty chunks again once the load
+ * has fitted in one chunk less for the cool-down period, measured in
+ * the unit of ParticleEventArg::dt. The initial chunk is always kept.
+ */
+template <class TYPE>
+class ParticlePool {
+private:
+    OpenEngine::ParticleSystem::ParticleSystem& system;
+    std::vector<ParticleCollection<TYPE>*> chunks;
+    unsigned int initialCapacity;
+    unsigned int chunkSize;
+    unsigned int maxCapacity;
+    unsigned int capacity;
+    unsigned int highWater;
+    float cooldown;
+    float idle;
+
+public:
+    ParticlePool(OpenEngine::ParticleSystem::ParticleSystem& system,
+                 unsigned int initialCapacity,
+                 unsigned int chunkSize = 0,
+                 unsigned int maxCapacity = 0,
+                 float cooldown = 5.0):
+        system(system),
+        initialCapacity(initialCapacity),
+        chunkSize(chunkSize > 0 ? chunkSize :
+                  initialCapacity > 0 ? initialCapacity : 1),
+        maxCapacity(maxCapacity > 0 ? maxCapacity : initialCapacity * 4),
+        capacity(initialCapacity),
+        highWater(0),
+        cooldown(cooldown),
+        idle(0.0)
+    {
+        chunks.push_back(system.CreateParticles<TYPE>(initialCapacity));
+    }
+
+    ~ParticlePool() {
+        for (unsigned int i = 0; i < chunks.size(); i++)
+            delete chunks[i];
+    }
+
+    unsigned int GetSize() {
+        return capacity;
+    }
+
+    unsigned int GetActiveParticles() {
+        unsigned int active = 0;
+        for (unsigned int i = 0; i < chunks.size(); i++)
+            active += chunks[i]->GetActiveParticles();
+        return active;
+    }
+
+    /**
+     * Make room for up to n new particles, growing the pool if needed
+     * and allowed. Returns the number of particles that can be
+     * created.
+     */
+    unsigned int Reserve(unsigned int n, bool grow = true) {
+        unsigned int free = capacity - GetActiveParticles();
+        while (grow && free < n && capacity < maxCapacity) {
+            unsigned int size = chunkSize;
+            if (capacity + size > maxCapacity)
+                size = maxCapacity - capacity;
+            chunks.push_back(system.CreateParticles<TYPE>(size));
+            capacity += size;
+            free += size;
+        }
+        return free < n ? free : n;
+    }
+
+    /**
+     * Create a particle in the first chunk with room. Call Reserve()
+     * first, the pool does not grow here.
+     */
+    TYPE& NewParticle() {
+        ParticleCollection<TYPE>* target = NULL;
+        unsigned int active = 1;
+        for (unsigned int i = 0; i < chunks.size(); i++) {
+            unsigned int n = chunks[i]->GetActiveParticles();
+            active += n;
+            if (!target && n < chunks[i]->GetSize())
+                target = chunks[i];
+        }
+        if (!target) target = chunks.back();
+        if (active > highWater) highWater = active;
+        return target->NewParticle();
+    }
+
+    void Update(float dt) {
+        unsigned int active = GetActiveParticles();
+
+        if (chunks.size() == 1 || active + chunks.back()->GetSize() > capacity) {
+            idle = 0.0;
+            return;
+        }
+        idle += dt;
+        if (idle < cooldown) return;
+        idle = 0.0;
+
+        // particles are packed into the lowest chunks, so the
+        // trailing ones drain first
+        while (chunks.size() > 1 &&
+               chunks.back()->GetActiveParticles() == 0 &&
+               active + chunks.back()->GetSize() <= capacity) {
+            capacity -= chunks.back()->GetSize();
+            delete chunks.back();
+            chunks.pop_back();
+        }
+    }
+
+    unsigned int GetChunkCount() {
+        return chunks.size();
+    }
+
+    ParticleCollection<TYPE>* GetChunk(unsigned int i) {
+        return chunks[i];
+    }
+
+    unsigned int GetHighWaterMark() {
+        return highWater;
+    }
+
+    void ResetHighWaterMark() {
+        highWater = 0;
+    }
+
+    unsigned int GetInitialCapacity() {
+        return initialCapacity;
+    }
+
+    void SetChunkSize(unsigned int size) {
+        if (size > 0) chunkSize = size;
+    }
+
+    unsigned int GetChunkSize() {
+        return chunkSize;
+    }
+
+    void SetMaxCapacity(unsigned int max) {
+        maxCapacity = max > initialCapacity ? max : initialCapacity;
+    }
+
+    unsigned int GetMaxCapacity() {
+        return maxCapacity;
+    }
+
+    void SetCooldown(float cooldown) {
+        this->cooldown = cooldown;
+    }
+
+    float GetCooldown() {
+        return cooldown;
+    }
+};
+
+}
+}
+#endif
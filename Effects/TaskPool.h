@@ -0,0 +1,228 @@
+#ifndef _OEPARTICLE_TASK_POOL_H_
+#define _OEPARTICLE_TASK_POOL_H_
+
+#include <vector>
+
+// worker threads are only available with posix threads, elsewhere the
+// pool runs the tasks on the calling thread
+#if defined(__unix__) || defined(__APPLE__)
+#define OE_EFFECTS_TASKPOOL_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#include <deque>
+#endif
+
+namespace OpenEngine {
+    namespace Effects {
+
+class ITask {
+public:
+    virtual ~ITask() {}
+    virtual void Run() = 0;
+};
+
+/**
+ * Fixed set of worker threads running batches of independent tasks.
+ *
+ * Run() deals the tasks round robin into one queue per thread and
+ * blocks until all of them are done, with the calling thread working
+ * as well. Each thread takes tasks from the back of its own queue and
+ * steals from the front of the others when it runs dry, which evens
+ * out batches of tasks with uneven cost.
+ *
+ * Without posix threads the pool has no workers and Run() executes
+ * the tasks in order on the calling thread.
+ */
+class TaskPool {
+#ifdef OE_EFFECTS_TASKPOOL_THREADS
+private:
+    struct Queue {
+        pthread_mutex_t lock;
+        std::deque<ITask*> tasks;
+    };
+
+    struct Worker {
+        TaskPool* pool;
+        unsigned int index;
+        pthread_t thread;
+    };
+
+    std::vector<Queue*> queues;
+    std::vector<Worker*> workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    unsigned int generation;
+    unsigned int pending;
+    bool quit;
+
+    ITask* Take(unsigned int index) {
+        Queue* own = queues[index];
+        pthread_mutex_lock(&own->lock);
+        if (!own->tasks.empty()) {
+            ITask* task = own->tasks.back();
+            own->tasks.pop_back();
+            pthread_mutex_unlock(&own->lock);
+            return task;
+        }
+        pthread_mutex_unlock(&own->lock);
+
+        for (unsigned int i = 1; i < queues.size(); i++) {
+            Queue* victim = queues[(index + i) % queues.size()];
+            pthread_mutex_lock(&victim->lock);
+            if (!victim->tasks.empty()) {
+                ITask* task = victim->tasks.front();
+                victim->tasks.pop_front();
+                pthread_mutex_unlock(&victim->lock);
+                return task;
+            }
+            pthread_mutex_unlock(&victim->lock);
+        }
+        return NULL;
+    }
+
+    void Participate(unsigned int index) {
+        ITask* task;
+        while ((task = Take(index)) != NULL) {
+            task->Run();
+            pthread_mutex_lock(&lock);
+            if (--pending == 0)
+                pthread_cond_signal(&done);
+            pthread_mutex_unlock(&lock);
+        }
+    }
+
+    static void* WorkerMain(void* arg) {
+        Worker* worker = static_cast<Worker*>(arg);
+        TaskPool* pool = worker->pool;
+        unsigned int seen = 0;
+        for (;;) {
+            pthread_mutex_lock(&pool->lock);
+            while (pool->generation == seen && !pool->quit)
+                pthread_cond_wait(&pool->work, &pool->lock);
+            if (pool->quit) {
+                pthread_mutex_unlock(&pool->lock);
+                return NULL;
+            }
+            seen = pool->generation;
+            pthread_mutex_unlock(&pool->lock);
+            pool->Participate(worker->index);
+        }
+    }
+
+public:
+    /**
+     * Create a pool with the given number of worker threads besides
+     * the calling thread. Defaults to one less than the number of
+     * online processors.
+     */
+    TaskPool(int threads = -1):
+        generation(0), pending(0), quit(false)
+    {
+        if (threads < 0) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = cpus > 1 ? cpus - 1 : 0;
+        }
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&work, NULL);
+        pthread_cond_init(&done, NULL);
+
+        // queue 0 belongs to the calling thread
+        for (int i = 0; i <= threads; i++) {
+            Queue* queue = new Queue();
+            pthread_mutex_init(&queue->lock, NULL);
+            queues.push_back(queue);
+        }
+        for (int i = 0; i < threads; i++) {
+            Worker* worker = new Worker();
+            worker->pool = this;
+            worker->index = i + 1;
+            if (pthread_create(&worker->thread, NULL, WorkerMain, worker) != 0) {
+                delete worker;
+                break;
+            }
+            workers.push_back(worker);
+        }
+    }
+
+    ~TaskPool() {
+        pthread_mutex_lock(&lock);
+        quit = true;
+        pthread_cond_broadcast(&work);
+        pthread_mutex_unlock(&lock);
+        for (unsigned int i = 0; i < workers.size(); i++) {
+            pthread_join(workers[i]->thread, NULL);
+            delete workers[i];
+        }
+        for (unsigned int i = 0; i < queues.size(); i++) {
+            pthread_mutex_destroy(&queues[i]->lock);
+            delete queues[i];
+        }
+        pthread_cond_destroy(&done);
+        pthread_cond_destroy(&work);
+        pthread_mutex_destroy(&lock);
+    }
+
+    /**
+     * Run all tasks and wait for them to finish. Not reentrant, call
+     * from one thread at a time.
+     */
+    void Run(std::vector<ITask*>& tasks) {
+        if (tasks.empty()) return;
+        if (workers.empty()) {
+            for (unsigned int i = 0; i < tasks.size(); i++)
+                tasks[i]->Run();
+            return;
+        }
+
+        // count the tasks before queueing them, a thread still busy
+        // stealing from the previous batch may pick them up at once
+        pthread_mutex_lock(&lock);
+        pending += tasks.size();
+        pthread_mutex_unlock(&lock);
+
+        // only the queues of running threads are used, a worker that
+        // failed to start would leave its share behind
+        unsigned int used = workers.size() + 1;
+        for (unsigned int i = 0; i < tasks.size(); i++) {
+            Queue* queue = queues[i % used];
+            pthread_mutex_lock(&queue->lock);
+            queue->tasks.push_back(tasks[i]);
+            pthread_mutex_unlock(&queue->lock);
+        }
+
+        pthread_mutex_lock(&lock);
+        generation++;
+        pthread_cond_broadcast(&work);
+        pthread_mutex_unlock(&lock);
+
+        Participate(0);
+
+        pthread_mutex_lock(&lock);
+        while (pending > 0)
+            pthread_cond_wait(&done, &lock);
+        pthread_mutex_unlock(&lock);
+    }
+
+    unsigned int GetNumberOfThreads() {
+        return workers.size() + 1;
+    }
+#else
+public:
+    TaskPool(int threads = -1) {}
+
+    void Run(std::vector<ITask*>& tasks) {
+        for (unsigned int i = 0; i < tasks.size(); i++)
+            tasks[i]->Run();
+    }
+
+    unsigned int GetNumberOfThreads() {
+        return 1;
+    }
+#endif
+};
+
+}
+}
+#endif
@@ -5,6 +5,11 @@
 #include <ParticleSystem/ParticleSystem.h>
 #include <ParticleSystem/ParticleCollection.h>
 #include <ParticleSystem/IParticleEffect.h>
+#include <Effects/ISchedulableEffect.h>
+#include <Effects/ParticleCuller.h>
+#include <Effects/EffectRecorder.h>
+#include <Effects/ParticlePool.h>
+#include <Effects/ParticleIdentity.h>
 
 // particle types
 #include <ParticleSystem/Particles/IParticle.h>
@@ -36,7 +41,7 @@
 
 #include <Meta/OpenGL.h>
 
-#include <Math/RandomGenerator.h>
+#include <Effects/EffectRandomGenerator.h>
 
 #include <Scene/TransformationNode.h>
 
@@ -49,15 +54,16 @@ using namespace ParticleSystem;
 using namespace Resources;
 using namespace Math;
 
-class TextEffect : public IParticleEffect {
+class TextEffect : public ISchedulableEffect {
 public:
-    typedef Color < Texture <Size < Velocity < Forces < Position < Life < IParticle > > > > > > >  TYPE;
+    typedef Identity < Color < Texture <Size < Velocity < Forces < Position < Life < IParticle > > > > > > > >  TYPE;
 
 private:
     class ParticleRenderer: public RenderNode {
     public:
-        ParticleRenderer(ParticleCollection<TYPE>* particles, Renderers::TextureLoader& textureLoader):
-            particles(particles), textureLoader(textureLoader) {}
+        ParticleRenderer(ParticlePool<TYPE>* particles, Renderers::TextureLoader& textureLoader,
+                         ParticleCuller& culler):
+            particles(particles), textureLoader(textureLoader), culler(culler) {}
         virtual ~ParticleRenderer() {}
 
         void Apply(RenderingEventArg arg, ISceneNodeVisitor& v) {
@@ -73,58 +79,83 @@ private:
             glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
             glEnable(GL_TEXTURE_2D);
             glEnable(GL_COLOR_MATERIAL);
+
+            // cull against the current camera before touching gl state
+            // for each quad
+            float mv[16], proj[16];
+            GLint viewport[4];
+            glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+            glGetFloatv(GL_PROJECTION_MATRIX, proj);
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            culler.SetCamera(mv, proj, viewport[2], viewport[3]);
+            culler.Begin();
+            for (unsigned int i = 0; i < particles->GetChunkCount(); i++) {
+                ParticleCollection<TYPE>* chunk = particles->GetChunk(i);
+                for (chunk->iterator.Reset(); 
+                     chunk->iterator.HasNext(); 
+                     chunk->iterator.Next()) {
+                    TYPE& particle = chunk->iterator.Element();
+                    culler.Test(particle.position, particle.size, particle.color[3],
+                                particle.id);
+                }
+            }
+            culler.End();
     
-            for (particles->iterator.Reset(); 
-                 particles->iterator.HasNext(); 
-                 particles->iterator.Next()) {
+            for (unsigned int i = 0; i < particles->GetChunkCount(); i++) {
+                ParticleCollection<TYPE>* chunk = particles->GetChunk(i);
+                for (chunk->iterator.Reset(); 
+                     chunk->iterator.HasNext(); 
+                     chunk->iterator.Next()) {
                 
-                TYPE& particle = particles->iterator.Element();
-                ITexture2DPtr texr = particle.texture;
+                    TYPE& particle = chunk->iterator.Element();
+                    if (!culler.Next()) continue;
+                    ITexture2DPtr texr = particle.texture;
                 
-                //Set texture
-                if (texr != NULL) {
-                    if (texr->GetID() == 0) {
-                        textureLoader.Load(texr);
-                        //logger.info << texr->GetID() << logger.end;
+                    //Set texture
+                    if (texr != NULL) {
+                        if (texr->GetID() == 0) {
+                            textureLoader.Load(texr);
+                            //logger.info << texr->GetID() << logger.end;
+                        }
+                        glBindTexture(GL_TEXTURE_2D, texr->GetID());
                     }
-                    glBindTexture(GL_TEXTURE_2D, texr->GetID());
-                }
                 
-                else {
-                    glBindTexture(GL_TEXTURE_2D, 0);
-                }
+                    else {
+                        glBindTexture(GL_TEXTURE_2D, 0);
+                    }
                 
-                glPushMatrix();
-                glTranslatef(particle.position[0], particle.position[1], particle.position[2]);
+                    glPushMatrix();
+                    glTranslatef(particle.position[0], particle.position[1], particle.position[2]);
                 
-                // billboard
-                float modelview[16];
-                glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
-                modelview[0] = modelview[5] = modelview[10] = 1.0;
-                modelview[1] = modelview[2] = modelview[4] = 
-                    modelview[6] = modelview[8] = modelview[9] = 0.0; 
-                glLoadMatrixf(modelview);
+                    // billboard
+                    float modelview[16];
+                    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+                    modelview[0] = modelview[5] = modelview[10] = 1.0;
+                    modelview[1] = modelview[2] = modelview[4] = 
+                        modelview[6] = modelview[8] = modelview[9] = 0.0; 
+                    glLoadMatrixf(modelview);
                 
-                // apply quad transformations
-                glRotatef(particle.rotation, 0,0,1);
-                float scale = particle.size;
-                glScalef(scale,scale,scale);
-                float c[4];
-                particle.color.ToArray(c);
-                glColor4fv(c);
+                    // apply quad transformations
+                    glRotatef(particle.rotation, 0,0,1);
+                    float scale = particle.size;
+                    glScalef(scale,scale,scale);
+                    float c[4];
+                    particle.color.ToArray(c);
+                    glColor4fv(c);
                 
-                glBegin(GL_QUADS);
-                glTexCoord2f(0.0, 0.0);
-                glVertex3f(-1.0, -1.0, 0.0);
-                glTexCoord2f(0.0, 1.0);
-                glVertex3f(-1.0, 1.0, 0);
-                glTexCoord2f(1.0, 1.0);
-                glVertex3f(1, 1, 0);
-                glTexCoord2f(1.0, 0.0);
-                glVertex3f(1, -1, 0);
-                glEnd();
+                    glBegin(GL_QUADS);
+                    glTexCoord2f(0.0, 0.0);
+                    glVertex3f(-1.0, -1.0, 0.0);
+                    glTexCoord2f(0.0, 1.0);
+                    glVertex3f(-1.0, 1.0, 0);
+                    glTexCoord2f(1.0, 1.0);
+                    glVertex3f(1, 1, 0);
+                    glTexCoord2f(1.0, 0.0);
+                    glVertex3f(1, -1, 0);
+                    glEnd();
                 
-                glPopMatrix();
+                    glPopMatrix();
+                }
             }
             glPopAttrib();
             glDisable(GL_BLEND);
@@ -135,12 +166,13 @@ private:
         }
 
     private:
-        ParticleCollection<TYPE>* particles;
+        ParticlePool<TYPE>* particles;
         TextureLoader& textureLoader; 
+        ParticleCuller& culler;
     };
 
 protected:
-    ParticleCollection<TYPE>* particles;
+    ParticlePool<TYPE>* particles;
     
     // emit attributes
     float life;
@@ -157,6 +189,7 @@ protected:
     
     bool active;
     
+    ParticleCuller culler;
     ParticleRenderer* pr;
     
     //modifiers
@@ -166,8 +199,12 @@ protected:
     LinearValueModifier<TYPE, float> sizemod;
     StaticForceModifier<TYPE> gravity;
     
-    RandomGenerator randomgen;
+    EffectRandomGenerator randomgen;
     TransformationNode* transPos;
+    EffectRecorder* recorder;
+
+    // id of the next emitted particle
+    unsigned int nextId;
 
     ITexture2DPtr tex;
     
@@ -178,14 +215,16 @@ public:
                float speed, float speedVar,
                Vector<3,float> gravity,
                Renderers::TextureLoader& textureLoader): 
-        particles(system.CreateParticles<TYPE>(numParticles)),
+        particles(new ParticlePool<TYPE>(system, numParticles)),
         life(life), lifeVar(lifeVar),
         speed(speed), speedVar(speedVar),
         system(system),
         active(false),
-        pr(new ParticleRenderer(particles, textureLoader)),
+        pr(new ParticleRenderer(particles, textureLoader, culler)),
         gravity(gravity),
-        transPos(NULL)
+        transPos(NULL),
+        recorder(NULL),
+        nextId(0)
     {
         randomgen.SeedWithTime();
      
@@ -193,16 +232,18 @@ public:
     
     TextEffect(OpenEngine::ParticleSystem::ParticleSystem& system, 
                TextureLoader& textureLoader): 
-        particles(system.CreateParticles<TYPE>(49)),
+        particles(new ParticlePool<TYPE>(system, 49)),
         life(6.1),
         lifeVar(0.5),
         speed(10),
         speedVar(1),
         system(system),
         active(false),
-        pr(new ParticleRenderer(particles, textureLoader)),
+        pr(new ParticleRenderer(particles, textureLoader, culler)),
         gravity(Vector<3,float>(0,-1.42,0)),
-        transPos(NULL)
+        transPos(NULL),
+        recorder(NULL),
+        nextId(0)
     {        
         tex = 
         ResourceManager<ITexture2D>::Create("1.tga");
@@ -221,21 +262,27 @@ public:
 }
 
 void Handle(ParticleEventArg e) {
-    for (particles->iterator.Reset(); 
-         particles->iterator.HasNext(); 
-         particles->iterator.Next()) {
-        TYPE& particle = particles->iterator.Element();
+    if (recorder) recorder->Handle(e.dt);
+
+    for (unsigned int i = 0; i < particles->GetChunkCount(); i++) {
+        ParticleCollection<TYPE>* chunk = particles->GetChunk(i);
+        for (chunk->iterator.Reset(); 
+             chunk->iterator.HasNext(); 
+             chunk->iterator.Next()) {
+            TYPE& particle = chunk->iterator.Element();
         
-        // predefined particle modifiers
-        gravity.Process(e.dt, particle);
-        eulermod.Process(e.dt, particle);
-        sizemod.Process(e.dt, particle, particle.size);
-        cmod.Process(e.dt, particle, particle.color);
-        lifemod.Process(e.dt, particle);
+            // predefined particle modifiers
+            gravity.Process(e.dt, particle);
+            eulermod.Process(e.dt, particle);
+            sizemod.Process(e.dt, particle, particle.size);
+            cmod.Process(e.dt, particle, particle.color);
+            lifemod.Process(e.dt, particle);
         
-        if (particle.life >= particle.maxlife)
-            particles->iterator.Delete();
+            if (particle.life >= particle.maxlife)
+                chunk->iterator.Delete();
+        }
     }
+    particles->Update(e.dt);
 }
 
 inline float RandomAttribute(float base, float variance) {
@@ -246,7 +293,7 @@ void inline Emit() {
 //     if (particles->GetActiveParticles() >= particles->GetSize())
 //         return;
  
-    if (particles->GetSize() == particles->GetActiveParticles())
+    if (particles->Reserve(1) == 0)
         return;
    
     Vector<3,float> position;
@@ -260,6 +307,7 @@ void inline Emit() {
     particle.position = position;
     
     particle.life = 0;
+    particle.id = nextId++;
     particle.maxlife = RandomAttribute(life, lifeVar);
     particle.size = 0;
     particle.rotation = 0;
@@ -275,15 +323,30 @@ ISceneNode* GetSceneNode() {
     return pr;
 }
 
+ParticlePool<TYPE>* GetParticlePool() {
+    return particles;
+}
+
+ParticleCuller& GetCuller() {
+    return culler;
+}
+
 void SetActive(bool active) {
+    if (recorder) recorder->SetActive(active);
     this->active = active;
+    if (active) Wake();
 }
 
 bool GetActive() {
     return active;
 }
 
+bool IsDormant() {
+    return particles->GetActiveParticles() == 0;
+}
+
 void Reset() {
+    if (recorder) recorder->Reset();
 }
 
 TransformationNode* GetTransformationNode() {
@@ -294,10 +357,37 @@ void SetTransformationNode(TransformationNode* node) {
     transPos = node;
 }
 
+void SetSeed(unsigned int seed) {
+    randomgen.Seed(seed);
+}
+
+/**
+ * Record all input to this effect. Attach before the first tick, the
+ * effect is reseeded from the recorder.
+ */
+void SetRecorder(EffectRecorder* recorder) {
+    this->recorder = recorder;
+    if (!recorder) return;
+    SetSeed(recorder->GetSeed());
+    recorder->SetActive(active);
+}
+
+EffectRecorder* GetRecorder() {
+    return recorder;
+}
+
 void EmitText(string s, TransformationNode* pos) {
+    if (recorder) {
+        Vector<3,float> position;
+        Quaternion<float> direction;
+        if (pos)
+            pos->GetAccumulatedTransformations(&position, &direction);
+        recorder->EmitText(s, position, direction);
+    }
     transPos = pos;
     Emit();
     transPos = NULL;
+    Wake();
 }
 
 };
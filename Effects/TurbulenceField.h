@@ -0,0 +1,157 @@
+#ifndef _OEPARTICLE_TURBULENCE_FIELD_H_
+#define _OEPARTICLE_TURBULENCE_FIELD_H_
+
+#include <Math/Vector.h>
+#include <Math/Math.h>
+#include <Math/RandomGenerator.h>
+
+#include <vector>
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+namespace OpenEngine {
+    namespace Effects {
+
+using namespace Math;
+
+/**
+ * Precomputed, tileable curl-noise velocity field.
+ *
+ * The field is the curl of a vector potential built from a few
+ * random plane waves with integer frequencies, so it is divergence
+ * free and wraps seamlessly at the grid boundary. It is evaluated
+ * once on a power of two grid, normalized to a maximum speed of one,
+ * and sampled with trilinear interpolation. Sample coordinates are in
+ * grid cells.
+ *
+ * Building the field is expensive, use GetShared() to let all effects
+ * sample the same instance.
+ */
+class TurbulenceField {
+private:
+    unsigned int res;
+    unsigned int mask;
+    // xyz plus padding per cell so a cell fits an sse register
+    std::vector<float> data;
+
+    unsigned int Index(int x, int y, int z) {
+        return (((z & mask) * res + (y & mask)) * res + (x & mask)) * 4;
+    }
+
+public:
+    TurbulenceField(unsigned int resolution = 32, unsigned int waves = 6,
+                    unsigned int seed = 0) {
+        res = 1;
+        while (res < resolution) res <<= 1;
+        mask = res - 1;
+        data.resize(res * res * res * 4, 0.0);
+
+        RandomGenerator randomgen;
+        randomgen.Seed(seed);
+
+        // the potential of each axis is a sum of plane waves
+        // a * sin(2pi/res * k.p + phase) with integer k, which tile
+        std::vector<Vector<3,float> > k(waves * 3);
+        std::vector<float> a(waves * 3), phase(waves * 3);
+        for (unsigned int i = 0; i < waves * 3; i++) {
+            int f = 1 + (i % waves) / 2;
+            for (unsigned int j = 0; j < 3; j++)
+                k[i][j] = floor(randomgen.UniformFloat(-f, f + 1));
+            a[i] = randomgen.UniformFloat(0.5, 1.0) / f;
+            phase[i] = randomgen.UniformFloat(0.0, 2 * Math::PI);
+        }
+
+        float w = 2 * Math::PI / res;
+        float maxSpeed = 0.0;
+        for (unsigned int z = 0; z < res; z++)
+            for (unsigned int y = 0; y < res; y++)
+                for (unsigned int x = 0; x < res; x++) {
+                    // gradients of the three potential components
+                    Vector<3,float> grad[3];
+                    for (unsigned int c = 0; c < 3; c++) {
+                        grad[c] = Vector<3,float>(0,0,0);
+                        for (unsigned int i = c * waves; i < (c + 1) * waves; i++) {
+                            float arg = w * (k[i][0]*x + k[i][1]*y + k[i][2]*z) + phase[i];
+                            grad[c] = grad[c] + k[i] * (a[i] * w * cos(arg));
+                        }
+                    }
+                    float* v = &data[Index(x, y, z)];
+                    v[0] = grad[2][1] - grad[1][2];
+                    v[1] = grad[0][2] - grad[2][0];
+                    v[2] = grad[1][0] - grad[0][1];
+                    float speed = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+                    if (speed > maxSpeed) maxSpeed = speed;
+                }
+
+        if (maxSpeed > 0.0)
+            for (unsigned int i = 0; i < data.size(); i++)
+                data[i] /= maxSpeed;
+    }
+
+    static TurbulenceField& GetShared() {
+        static TurbulenceField field;
+        return field;
+    }
+
+    unsigned int GetResolution() {
+        return res;
+    }
+
+    Vector<3,float> Sample(float x, float y, float z) {
+        float fx = floor(x), fy = floor(y), fz = floor(z);
+        int x0 = int(fx), y0 = int(fy), z0 = int(fz);
+        fx = x - fx; fy = y - fy; fz = z - fz;
+        const float* d = &data[0];
+
+#ifdef __SSE__
+        __m128 c000 = _mm_loadu_ps(d + Index(x0,   y0,   z0));
+        __m128 c100 = _mm_loadu_ps(d + Index(x0+1, y0,   z0));
+        __m128 c010 = _mm_loadu_ps(d + Index(x0,   y0+1, z0));
+        __m128 c110 = _mm_loadu_ps(d + Index(x0+1, y0+1, z0));
+        __m128 c001 = _mm_loadu_ps(d + Index(x0,   y0,   z0+1));
+        __m128 c101 = _mm_loadu_ps(d + Index(x0+1, y0,   z0+1));
+        __m128 c011 = _mm_loadu_ps(d + Index(x0,   y0+1, z0+1));
+        __m128 c111 = _mm_loadu_ps(d + Index(x0+1, y0+1, z0+1));
+
+        __m128 wx = _mm_set1_ps(fx);
+        __m128 c00 = _mm_add_ps(c000, _mm_mul_ps(_mm_sub_ps(c100, c000), wx));
+        __m128 c10 = _mm_add_ps(c010, _mm_mul_ps(_mm_sub_ps(c110, c010), wx));
+        __m128 c01 = _mm_add_ps(c001, _mm_mul_ps(_mm_sub_ps(c101, c001), wx));
+        __m128 c11 = _mm_add_ps(c011, _mm_mul_ps(_mm_sub_ps(c111, c011), wx));
+
+        __m128 wy = _mm_set1_ps(fy);
+        __m128 c0 = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), wy));
+        __m128 c1 = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), wy));
+
+        __m128 wz = _mm_set1_ps(fz);
+        __m128 c = _mm_add_ps(c0, _mm_mul_ps(_mm_sub_ps(c1, c0), wz));
+
+        float r[4];
+        _mm_storeu_ps(r, c);
+        return Vector<3,float>(r[0], r[1], r[2]);
+#else
+        float r[3];
+        for (unsigned int i = 0; i < 3; i++) {
+            float c00 = d[Index(x0,y0,z0)+i]     + (d[Index(x0+1,y0,z0)+i]     - d[Index(x0,y0,z0)+i])     * fx;
+            float c10 = d[Index(x0,y0+1,z0)+i]   + (d[Index(x0+1,y0+1,z0)+i]   - d[Index(x0,y0+1,z0)+i])   * fx;
+            float c01 = d[Index(x0,y0,z0+1)+i]   + (d[Index(x0+1,y0,z0+1)+i]   - d[Index(x0,y0,z0+1)+i])   * fx;
+            float c11 = d[Index(x0,y0+1,z0+1)+i] + (d[Index(x0+1,y0+1,z0+1)+i] - d[Index(x0,y0+1,z0+1)+i]) * fx;
+            float c0 = c00 + (c10 - c00) * fy;
+            float c1 = c01 + (c11 - c01) * fy;
+            r[i] = c0 + (c1 - c0) * fz;
+        }
+        return Vector<3,float>(r[0], r[1], r[2]);
+#endif
+    }
+
+    Vector<3,float> Sample(const Vector<3,float>& p) {
+        return Sample(p[0], p[1], p[2]);
+    }
+};
+
+}
+}
+#endif
@@ -0,0 +1,92 @@
+#ifndef _OEPARTICLE_TURBULENCE_MODIFIER_H_
+#define _OEPARTICLE_TURBULENCE_MODIFIER_H_
+
+#include <Effects/TurbulenceField.h>
+#include <Math/Vector.h>
+
+#include <cmath>
+
+namespace OpenEngine {
+    namespace Effects {
+
+using namespace Math;
+
+/**
+ * Pushes particles along a turbulence field.
+ *
+ * The particle position is scaled into grid cells and offset by a
+ * scroll vector that moves with time, so the wind pattern drifts
+ * through the effect. The sampled velocity, times the strength, is
+ * applied as an acceleration. Without a field the modifier does
+ * nothing.
+ */
+template <class T>
+class TurbulenceModifier {
+private:
+    TurbulenceField* field;
+    float strength;
+    float scale;
+    Vector<3,float> scroll;
+    Vector<3,float> offset;
+
+public:
+    TurbulenceModifier(TurbulenceField* field = NULL,
+                       float strength = 1.0,
+                       float scale = 1.0):
+        field(field), strength(strength), scale(scale),
+        scroll(0,0,0), offset(0,0,0) {}
+
+    void Update(float dt) {
+        offset = offset + scroll * dt;
+        if (!field) return;
+        // the field tiles, keep the offset within one tile so it does
+        // not lose precision over a long session
+        float res = field->GetResolution();
+        for (unsigned int i = 0; i < 3; i++) {
+            offset[i] = fmod(offset[i], res);
+            if (offset[i] < 0.0) offset[i] += res;
+        }
+    }
+
+    inline void Process(float dt, T& particle) {
+        if (!field) return;
+        Vector<3,float> wind = field->Sample(particle.position * scale + offset);
+        particle.velocity = particle.velocity + wind * (strength * dt);
+    }
+
+    void SetField(TurbulenceField* field) {
+        this->field = field;
+    }
+
+    TurbulenceField* GetField() {
+        return field;
+    }
+
+    void SetStrength(float strength) {
+        this->strength = strength;
+    }
+
+    float GetStrength() {
+        return strength;
+    }
+
+    void SetScale(float scale) {
+        this->scale = scale;
+    }
+
+    float GetScale() {
+        return scale;
+    }
+
+    void SetScroll(Vector<3,float> scroll) {
+        this->scroll = scroll;
+    }
+
+    Vector<3,float> GetScroll() {
+        return scroll;
+    }
+};
+
+}
+}
+#endif
@@ -0,0 +1,97 @@
+// Headless test of the particle culler, needs only Math/Vector.h.
+
+#include <Effects/ParticleCuller.h>
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+using namespace OpenEngine::Effects;
+using namespace OpenEngine::Math;
+
+static const int WIDTH = 800;
+static const int HEIGHT = 600;
+
+// identity modelview and a 90 degree perspective with near 1, far 100
+static void SetupCamera(ParticleCuller& culler) {
+    float n = 1.0, f = 100.0;
+    float modelview[16] = {0};
+    float projection[16] = {0};
+    modelview[0] = modelview[5] = modelview[10] = modelview[15] = 1.0;
+    projection[0] = projection[5] = 1.0;
+    projection[10] = -(f + n) / (f - n);
+    projection[11] = -1.0;
+    projection[14] = -2.0 * f * n / (f - n);
+    culler.SetCamera(modelview, projection, WIDTH, HEIGHT);
+}
+
+static bool Near(float a, float b) {
+    return fabs(a - b) < 1e-4;
+}
+
+static void TestCulling() {
+    ParticleCuller culler;
+    SetupCamera(culler);
+    culler.Begin();
+
+    // centred at depth 2 a unit half size spans half the viewport
+    assert(culler.Test(Vector<3,float>(0,0,-2), 1.0, 1.0, 0u));
+    // behind the camera
+    assert(!culler.Test(Vector<3,float>(0,0,5), 1.0, 1.0, 1u));
+    // sub-pixel at the far plane
+    assert(!culler.Test(Vector<3,float>(0,0,-99), 0.0001, 1.0, 2u));
+    // fully transparent
+    assert(!culler.Test(Vector<3,float>(0,0,-2), 1.0, 0.0, 3u));
+    // the axis aligned quad starts at x 1.1 in ndc, only a corner
+    // of the spun quad reaches into the viewport
+    assert(culler.Test(Vector<3,float>(3.2,0,-2), 1.0, 1.0, 4u));
+    // even the corners stay outside
+    assert(!culler.Test(Vector<3,float>(3.6,0,-2), 1.0, 1.0, 5u));
+    culler.End();
+
+    assert(culler.GetCulled() == 4);
+    assert(Near(culler.GetCoverage(), 0.5));
+    assert(Near(culler.GetKeepRatio(), 1.0));
+
+    bool expected[] = { true, false, false, false, true, false };
+    for (unsigned int i = 0; i < 6; i++)
+        assert(culler.Next() == expected[i]);
+    assert(culler.GetThinned() == 0);
+}
+
+static void TestOverdrawBudget() {
+    const unsigned int count = 400;
+    ParticleCuller culler;
+    SetupCamera(culler);
+    culler.SetOverdrawBudget(1.0);
+
+    bool first[count];
+    for (unsigned int frame = 0; frame < 2; frame++) {
+        culler.Begin();
+        // each particle covers a quarter of the viewport
+        for (unsigned int i = 0; i < count; i++)
+            assert(culler.Test(Vector<3,float>(0,0,-2), 1.0, 1.0, i));
+        culler.End();
+
+        assert(Near(culler.GetCoverage(), count * 0.25));
+        assert(Near(culler.GetKeepRatio(), 4.0 / count));
+
+        unsigned int drawn = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            bool draw = culler.Next();
+            if (frame == 0) first[i] = draw;
+            // the same particles are kept every frame
+            else assert(draw == first[i]);
+            if (draw) drawn++;
+        }
+        assert(drawn > 0 && drawn < 16);
+        assert(culler.GetThinned() == count - drawn);
+    }
+}
+
+int main() {
+    TestCulling();
+    TestOverdrawBudget();
+    printf("ParticleCullerTest passed\n");
+    return 0;
+}